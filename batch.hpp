@@ -0,0 +1,315 @@
+/*
+ * Batch evaluation routines for calling the calculator from other programs
+ *
+ * Nothing in here does console I/O or keeps state between calls; every input
+ * and output buffer belongs to the caller, so concurrent calls on separate
+ * output buffers are safe. boltzmannSums, boltzmannWeights and evaluateBatch
+ * allocate no arrays, and with a fixed-size number type (double, cpp_bin_float)
+ * make no heap allocations at all; the limbs of dynamically sized types such as
+ * mpfr_float_1000 still live on the heap. parallelFor allocates its thread list
+ * and evaluateSystems a per-system shift array.
+ * The Boltzmann constant is passed in, so this header depends on neither Boost nor MPFR.
+ */
+
+#ifndef BATCH_HPP
+    #define BATCH_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "hpmath.hpp"
+
+/**
+ * split the index range [0, n) into contiguous blocks and process each block on its own thread
+ * @param n             the number of indices
+ * @param threads       the number of threads to use; 0 uses every hardware thread
+ * @param body          callable taking the first and one-past-the-last index of a block
+ */
+template <typename Function>
+void parallelFor(const unsigned int n, unsigned int threads, Function body) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (threads > n) {
+        threads = (n > 0 ? n : 1);
+    }
+
+    std::vector<std::thread> workers;
+    const unsigned int block = n / threads, extra = n % threads;
+    unsigned int first = 0;
+    for (unsigned int i = 0; i < threads; i++) {
+        // the first (n % threads) blocks take one extra index
+        unsigned int last = first + block + (i < extra ? 1 : 0);
+        // run the last block on this thread
+        if (i + 1 == threads) {
+            body(first, last);
+        }
+        else {
+            workers.emplace_back(body, first, last);
+        }
+        first = last;
+    }
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+namespace Thermodynamics {
+    //! quantum statistics of identical particles
+    enum Statistics {
+        bosons,
+        fermions
+    };
+
+    /**
+     * calculate the partition function and the un-normalized state weights at a single temperature
+     * @param E             (eV) array of n state energies
+     * @param mu            (eV) array of n total chemical potentials
+     * @param occupancy     array of n particle numbers, or nullptr to skip the particle number sums
+     * @param n             the number of states
+     * @param beta          (per eV) the inverse of the fundamental temperature
+     * @param shift         (eV) added to every exponent's mu - E; the weights and Z are scaled by exp(shift / tau)
+     * @param W             output array of n Boltzmann factors
+     * @param N_sum         output \Sum N_j W_j
+     * @param N2_sum        output \Sum N_j^2 W_j
+     * @return              the partition function, scaled like the weights
+     */
+    template <typename Num>
+    Num boltzmannSums(const Num* E, const Num* mu, const Num* occupancy, const unsigned short int n,
+                      const Num& beta, const Num& shift, Num* W, Num& N_sum, Num& N2_sum) {
+        Num Z = 0.0;
+        N_sum = N2_sum = 0.0;
+        // Z(tau) == \Sum_{j=0}^{\Infinity} \exp{(\mu - E) / \tau}
+        for (unsigned short int i = 0; i < n; i++) {
+            W[i] = exp((mu[i] - E[i] + shift) * beta);
+            Z += W[i];
+            if (occupancy != nullptr) {
+                N_sum += occupancy[i] * W[i];
+                N2_sum += occupancy[i] * occupancy[i] * W[i];
+            }
+        }
+
+        return Z;
+    }
+
+    /**
+     * return the smallest E - mu over the states, which shifted to zero keeps every exponent <= 0
+     * @param E             (eV) array of n state energies
+     * @param mu            (eV) array of n total chemical potentials
+     * @param n             the number of states
+     * @return              (eV) min_i (E_i - mu_i), or 0 if there are no states
+     */
+    template <typename Num>
+    Num lowestLevel(const Num* E, const Num* mu, const unsigned short int n) {
+        Num lowest = (n > 0 ? E[0] - mu[0] : static_cast<Num>(0));
+        for (unsigned short int i = 1; i < n; i++) {
+            if (E[i] - mu[i] < lowest) {
+                lowest = E[i] - mu[i];
+            }
+        }
+
+        return lowest;
+    }
+
+    /**
+     * calculate the logarithm of the partition function and the state probabilities at a single temperature;
+     * the exponents are shifted by the lowest level first, so neither the weights nor Z overflow or underflow
+     * @param E             (eV) array of n state energies
+     * @param mu            (eV) array of n total chemical potentials
+     * @param occupancy     array of n particle numbers, or nullptr to skip the particle number moments
+     * @param n             the number of states
+     * @param beta          (per eV) the inverse of the fundamental temperature
+     * @param P             output array of n state probabilities
+     * @param N_mean        output mean number of particles
+     * @param N_variance    output variance of the number of particles
+     * @return              ln Z
+     */
+    template <typename Num>
+    Num boltzmannWeights(const Num* E, const Num* mu, const Num* occupancy, const unsigned short int n,
+                         const Num& beta, Num* P, Num& N_mean, Num& N_variance) {
+        using std::log;
+        Num N_sum, N2_sum;
+        const Num shift = lowestLevel(E, mu, n);
+        Num Z = boltzmannSums(E, mu, occupancy, n, beta, shift, P, N_sum, N2_sum);
+        // divide by Z to get the probability for each state
+        for (unsigned short int i = 0; i < n; i++) {
+            P[i] /= Z;
+        }
+        // <N> == \Sum N_j P_j; d<N>/d\mu == (<N^2> - <N>^2) / \tau
+        N_mean = N_sum / Z;
+        N_variance = N2_sum / Z - N_mean * N_mean;
+
+        // ln Z == ln(\Sum \exp{(\mu - E + shift) / \tau}) - shift / \tau
+        return log(Z) - shift * beta;
+    }
+
+    /**
+     * calculate the partition function and the state probabilities over a set of temperatures
+     * @param E             (eV) array of n state energies
+     * @param mu            (eV) array of n total chemical potentials
+     * @param occupancy     array of n particle numbers, or nullptr
+     * @param n             the number of states
+     * @param T             (K) array of n_T temperatures
+     * @param n_T           the number of temperatures
+     * @param k_B           (eV/K) the Boltzmann constant
+     * @param lnZ           output array of n_T logarithms of the partition function
+     * @param P             output array of n_T * n state probabilities, one row of n per temperature
+     * @param N             output array of n_T mean particle numbers, or nullptr
+     * @param dN_dmu        (per eV) output array of n_T derivatives of <N> with respect to mu, or nullptr
+     * @return              whether or not every ln Z and probability is finite
+     */
+    template <typename Num>
+    bool evaluateBatch(const Num* E, const Num* mu, const Num* occupancy, const unsigned short int n,
+                       const Num* T, const unsigned int n_T, const Num k_B, Num* lnZ, Num* P, Num* N, Num* dN_dmu) {
+        Num tau, beta, N_mean, N_variance;
+        bool finite = true;
+        for (unsigned int t = 0; t < n_T; t++) {
+            tau = k_B * T[t];
+            beta = 1 / tau;
+            Num* P_row = P + static_cast<std::size_t>(t) * n;
+            lnZ[t] = boltzmannWeights(E, mu, occupancy, n, beta, P_row, N_mean, N_variance);
+            if (N != nullptr) {
+                N[t] = N_mean;
+            }
+            if (dN_dmu != nullptr) {
+                dN_dmu[t] = N_variance / tau;
+            }
+            finite = finite && isFinite(lnZ[t]);
+            for (unsigned short int i = 0; i < n; i++) {
+                finite = finite && isFinite(P_row[i]);
+            }
+        }
+
+        return finite;
+    }
+
+    /**
+     * calculate the canonical partition functions of 0 to N identical particles from the single-particle
+     * Boltzmann factors, using Z_N == (1/N) \Sum_{k=1}^{N} (\pm 1)^{k+1} Z_1(k \beta) Z_{N-k}
+     * @param W             array of n single-particle Boltzmann factors at beta
+     * @param n             the number of states
+     * @param N             the largest number of particles
+     * @param stats         whether the particles are bosons or fermions
+     * @param W_k           scratch array of n values
+     * @param Z1            output array of N+1 single-particle partition functions Z_1(k \beta)
+     * @param Z_N           output array of N+1 canonical partition functions Z_0 to Z_N
+     */
+    template <typename Num>
+    void canonicalPartitions(const Num* W, const unsigned short int n, const unsigned short int N,
+                             const Statistics stats, Num* W_k, Num* Z1, Num* Z_N) {
+        // Z_1(k \beta) == \Sum_j W_j^k, built up one power at a time so no further exponentials are needed
+        Z1[0] = n;
+        for (unsigned short int i = 0; i < n; i++) {
+            W_k[i] = 1;
+        }
+        for (unsigned short int k = 1; k <= N; k++) {
+            Z1[k] = 0.0;
+            for (unsigned short int i = 0; i < n; i++) {
+                W_k[i] *= W[i];
+                Z1[k] += W_k[i];
+            }
+        }
+
+        // the fermionic terms alternate in sign and cancel heavily; the working precision has to absorb that
+        Z_N[0] = 1;
+        for (unsigned short int m = 1; m <= N; m++) {
+            Z_N[m] = 0.0;
+            // there is no way to put more fermions than states into the system
+            if (stats == fermions && m > n) {
+                continue;
+            }
+            for (unsigned short int k = 1; k <= m; k++) {
+                if (stats == fermions && k % 2 == 0) {
+                    Z_N[m] -= Z1[k] * Z_N[m - k];
+                }
+                else {
+                    Z_N[m] += Z1[k] * Z_N[m - k];
+                }
+            }
+            Z_N[m] /= m;
+        }
+    }
+
+    /**
+     * calculate the partition functions and the state probabilities of several systems over one set of
+     * temperatures; the per-temperature factors are computed once and shared by every system, and the
+     * temperatures are split between threads. The levels are interleaved: entry j * K + k holds state j of
+     * system k, so the inner loop runs over the systems with unit stride and one temperature is one pass.
+     * Systems with fewer than n_max states are padded; the padding is ignored on input and zeroed in P.
+     * @param E             (eV) interleaved array of n_max * K state energies
+     * @param mu            (eV) interleaved array of total chemical potentials, laid out like E
+     * @param n             array of K state counts
+     * @param K             the number of systems
+     * @param n_max         the largest state count
+     * @param T             (K) array of n_T temperatures
+     * @param n_T           the number of temperatures
+     * @param k_B           (eV/K) the Boltzmann constant
+     * @param tau           (eV) output array of n_T fundamental temperatures, or nullptr
+     * @param lnZ           output array of n_T * K logarithms of the partition functions, one row of K per temperature
+     * @param P             output array of n_T * n_max * K state probabilities, one row per temperature laid out like E
+     * @param threads       the number of threads to use; 0 uses every hardware thread
+     */
+    template <typename Num>
+    void evaluateSystems(const Num* E, const Num* mu, const unsigned short int* n, const unsigned short int K,
+                         const unsigned short int n_max, const Num* T, const unsigned int n_T, const Num k_B,
+                         Num* tau, Num* lnZ, Num* P, const unsigned int threads) {
+        using std::log;
+        const std::size_t row_size = static_cast<std::size_t>(n_max) * K;
+        // each system's lowest E - mu does not depend on temperature, so find them once
+        std::vector<Num> shift(K);
+        for (unsigned short int k = 0; k < K; k++) {
+            for (unsigned short int j = 0; j < n[k]; j++) {
+                const std::size_t idx = static_cast<std::size_t>(j) * K + k;
+                if (j == 0 || E[idx] - mu[idx] < shift[k]) {
+                    shift[k] = E[idx] - mu[idx];
+                }
+            }
+        }
+
+        parallelFor(n_T, threads, [&](const unsigned int first, const unsigned int last) {
+            Num tau_t, beta;
+            for (unsigned int t = first; t < last; t++) {
+                tau_t = k_B * T[t];
+                beta = 1 / tau_t;
+                if (tau != nullptr) {
+                    tau[t] = tau_t;
+                }
+                // accumulate every system's Z in its slot of the lnZ row, then take the logarithm at the end
+                Num* Z_row = lnZ + static_cast<std::size_t>(t) * K;
+                Num* P_row = P + t * row_size;
+                for (unsigned short int k = 0; k < K; k++) {
+                    Z_row[k] = 0.0;
+                }
+                for (unsigned short int j = 0; j < n_max; j++) {
+                    for (unsigned short int k = 0; k < K; k++) {
+                        const std::size_t idx = static_cast<std::size_t>(j) * K + k;
+                        if (j < n[k]) {
+                            P_row[idx] = exp((mu[idx] - E[idx] + shift[k]) * beta);
+                            Z_row[k] += P_row[idx];
+                        }
+                        else {
+                            P_row[idx] = 0.0;
+                        }
+                    }
+                }
+                for (unsigned short int j = 0; j < n_max; j++) {
+                    for (unsigned short int k = 0; k < K; k++) {
+                        if (j < n[k]) {
+                            P_row[static_cast<std::size_t>(j) * K + k] /= Z_row[k];
+                        }
+                    }
+                }
+                for (unsigned short int k = 0; k < K; k++) {
+                    Z_row[k] = log(Z_row[k]) - shift[k] * beta;
+                }
+            }
+        });
+    }
+}
+
+#endif
@@ -18,6 +18,7 @@
 
 #include "hpmath.hpp"
 #include "templates.hpp"
+#include "batch.hpp"
 
 ///////////////////
 ///// Objects /////
@@ -38,6 +39,10 @@ namespace Thermodynamics{
         Num* E;
         //! (eV) owning pointer to array of total chemical potentials
         Num* TOTAL_POTENTIAL;
+        //! owning pointer to array of particle numbers for each state; null unless grand canonical
+        Num* OCCUPANCY;
+        //! (eV) chemical potential per particle in the grand canonical mode
+        Num POTENTIAL;
         //! (K) temperature
         Num TEMPERATURE;
       public:
@@ -52,12 +57,27 @@ namespace Thermodynamics{
         Num T(void) const {return this->TEMPERATURE;}
         void set_T(const Num temp) {this->TEMPERATURE = temp;}
         void set_mu(const unsigned short i, const Num potential) {this->TOTAL_POTENTIAL[i] = potential;}
+        void set_energy(const unsigned short i, const Num energy) {this->E[i] = energy;}
         //! return the total chemical potential of a state
         Num mu(unsigned short int i) const {return (i < this->n ? this->TOTAL_POTENTIAL[i] : static_cast<Num>(0));}
         //! return the energy of a state
         Num energy(unsigned short int i) const {return (i < this->n ? this->E[i] : static_cast<Num>(0));}
+        //! return the number of particles in a state
+        Num occupancy(unsigned short int i) const {return (i < this->n && this->OCCUPANCY != nullptr ? this->OCCUPANCY[i] : static_cast<Num>(0));}
+        //! return whether particle numbers have been given for the states
+        bool grand_canonical(void) const {return this->OCCUPANCY != nullptr;}
+        //! return the chemical potential per particle
+        Num potential(void) const {return this->POTENTIAL;}
+        void set_potential(const Num);
+        //! return the array of state energies
+        const Num* energies(void) const {return this->E;}
+        //! return the array of total chemical potentials
+        const Num* potentials(void) const {return this->TOTAL_POTENTIAL;}
+        //! return the array of particle numbers, or nullptr if there is none
+        const Num* occupancies(void) const {return this->OCCUPANCY;}
         // other functions
-        SystemParameters& acquire(const std::string);
+        SystemParameters& acquire(const std::string, const bool = true);
+        SystemParameters& acquire_occupancy(void);
     };
 
     /**
@@ -65,19 +85,40 @@ namespace Thermodynamics{
      */
     template <typename Num>
     class PartitionFunctionSample {
-        //! size of state probability array
+        //! size of state weight array
         unsigned short int states;
         //! (eV) fundamental temperature
         Num TAU;
+        //! (per eV) inverse of the fundamental temperature
+        Num BETA;
         //! partition function at tau
         Num PARTITION;
-        //! owning pointer to state probability array
-        Num* P;
+        //! owning pointer to un-normalized state weight array; probabilities are W_i / Z
+        Num* W;
         //! (eV) owning pointer to array of total chemical potentials
         Num* TOTAL_POTENTIAL;
+        //! (eV) chemical potential per particle
+        Num POTENTIAL;
+        //! \Sum N_j W_j
+        Num N_SUM;
+        //! \Sum N_j^2 W_j
+        Num N2_SUM;
         //! (K) temperature
         Num TEMPERATURE;
+        //! number of incremental updates since Z was last summed from scratch
+        unsigned int updates;
+        //! number of identical particles in the canonical calculation; 0 if there is none
+        unsigned short int n_particles;
+        //! owning pointer to array of single-particle partition functions at multiples of beta
+        Num* Z_SINGLE;
+        //! owning pointer to array of canonical partition functions for 0 to n_particles particles
+        Num* Z_CANONICAL;
+        //! owning pointer to scratch array of powers of the state weights for the canonical recursion
+        Num* W_POWER;
+        void resum(const SystemParameters<Num>&);
       public:
+        //! number of incremental updates after which Z is summed from scratch to bound rounding drift
+        static const unsigned int refresh_interval = 64;
         ~PartitionFunctionSample(void);
         PartitionFunctionSample(const unsigned int);
         PartitionFunctionSample(void);
@@ -87,13 +128,27 @@ namespace Thermodynamics{
         //! return the value of the partition function
         Num Z(void) const {return this->PARTITION;}
         //! return the probability of the given state
-        Num P_i(unsigned short int i) const {return (i < this->states ? this->P[i] : static_cast<Num>(0));}
+        Num P_i(unsigned short int i) const {return (i < this->states ? this->W[i] / this->PARTITION : static_cast<Num>(0));}
         //! return the chemical potential of the given state
         Num mu_i(unsigned short int i) const {return (i < this->states ? this->TOTAL_POTENTIAL[i] : static_cast<Num>(0));}
         //! return the temperature of the system
         Num T(void) const {return this->TEMPERATURE;}
+        //! return the chemical potential per particle
+        Num mu(void) const {return this->POTENTIAL;}
+        //! return the mean number of particles
+        Num N(void) const {return this->N_SUM / this->PARTITION;}
+        //! (per eV) return the derivative of the mean number of particles with respect to mu
+        Num dN_dmu(void) const {return (this->N2_SUM / this->PARTITION - this->N() * this->N()) * this->BETA;}
+        //! return the number of identical particles in the canonical calculation
+        unsigned short int particles(void) const {return this->n_particles;}
+        //! return the canonical partition function of m identical particles
+        Num Z_N(unsigned short int m) const {return (m <= this->n_particles && this->Z_CANONICAL != nullptr ? this->Z_CANONICAL[m] : static_cast<Num>(0));}
         // calculation
         void calculate(SystemParameters<Num>&);
+        void calculate(const SystemParameters<Num>&, const Num);
+        void calculate_canonical(const SystemParameters<Num>&, const Num, const unsigned short int, const Statistics);
+        void update_state(const SystemParameters<Num>&, const unsigned short int);
+        bool solve_mu(SystemParameters<Num>&, const Num, const Num, const Num);
         // initialization in case the default constructor was used
         void initialize(unsigned short int);
     };
@@ -114,6 +169,48 @@ namespace Thermodynamics{
         unsigned short int n_samp(void) {return number_of_samples;}
         bool save_to_disk(std::string);
         void initialize(const unsigned short int);
+        void update_state(const unsigned short int, const Num);
+    };
+
+    /**
+     * manages several systems that are evaluated together on one temperature grid
+     */
+    template <typename Num>
+    class SystemEnsemble {
+        //! number of systems
+        unsigned short int K = 0;
+        //! number of temperature samples
+        unsigned short int number_of_samples = 0;
+        //! largest number of states of any system
+        unsigned short int n_max = 0;
+        //! owning pointer to the number of states of each system
+        unsigned short int* n;
+        //! (eV) owning pointer to interleaved array of energies; entry j * K + k is state j of system k
+        Num* E;
+        //! (eV) owning pointer to interleaved array of total chemical potentials, laid out like E
+        Num* TOTAL_POTENTIAL;
+        //! (K) owning pointer to array of temperatures
+        Num* TEMPERATURE;
+        //! (eV) owning pointer to array of fundamental temperatures
+        Num* TAU;
+        //! owning pointer to logarithms of the partition functions, one row of K per temperature
+        Num* LN_PARTITION;
+        //! owning pointer to state probabilities, one row per temperature laid out like E
+        Num* P;
+      public:
+        //! owning pointer to the parameters of each system
+        SystemParameters<Num>* params;
+        //! the name of the file to save to
+        std::string filename;
+        ~SystemEnsemble(void);
+        SystemEnsemble(void);
+        //! return the number of systems
+        unsigned short int systems(void) const {return this->K;}
+        unsigned short int n_samp(void) const {return this->number_of_samples;}
+        SystemEnsemble& acquire(const unsigned short int);
+        void initialize(const unsigned short int);
+        void calculate(const Num, const Num, const unsigned int);
+        bool save_to_disk(std::string);
     };
 }
 
@@ -149,8 +246,10 @@ template <typename Num>
 Thermodynamics::SystemParameters<Num>::~SystemParameters(void) {
     delete [] this->E;
     delete [] this->TOTAL_POTENTIAL;
+    delete [] this->OCCUPANCY;
     this->E = nullptr;
     this->TOTAL_POTENTIAL = nullptr;
+    this->OCCUPANCY = nullptr;
     this->n = 0;
 }
 
@@ -161,16 +260,20 @@ template <typename Num>
 Thermodynamics::SystemParameters<Num>::SystemParameters(void) {
     this->E = nullptr;
     this->TOTAL_POTENTIAL = nullptr;
+    this->OCCUPANCY = nullptr;
+    this->POTENTIAL = 0.0;
     this->n = 0;
 }
 
 /**
  * acquire system information from a file or user input
  * @param cfg_name      the name of the config file
+ * @param ask_filename  whether to ask for a results file name when the config file is not used
  * @return              itself, by reference
  */
 template <typename Num>
-Thermodynamics::SystemParameters<Num>& Thermodynamics::SystemParameters<Num>::acquire(const std::string cfg_name) {
+Thermodynamics::SystemParameters<Num>& Thermodynamics::SystemParameters<Num>::acquire(const std::string cfg_name,
+                                                                                      const bool ask_filename) {
     std::ifstream config(cfg_name);
     std::string use_cfg_response;
     // try to read from a config file first
@@ -205,8 +308,10 @@ Thermodynamics::SystemParameters<Num>& Thermodynamics::SystemParameters<Num>::ac
 
     if (static_cast<char>(tolower(use_cfg_response[0])) == 'n' || !config.good()) {
         // file name
-        std::cout << "\nEnter a filename to save the results (CSV format, will be overwritten): ";
-        std::getline(std::cin, this->filename);
+        if (ask_filename) {
+            std::cout << "\nEnter a filename to save the results (CSV format, will be overwritten): ";
+            std::getline(std::cin, this->filename);
+        }
 
         std::cout << "How many states does the partition function have? ";
         rangedGetterLoop(std::cin, std::cout, this->n, static_cast<unsigned short>(0),
@@ -224,6 +329,7 @@ Thermodynamics::SystemParameters<Num>& Thermodynamics::SystemParameters<Num>::ac
                       ((i+1 % 10 == 3 && i+1 % 100 != 13) ? "rd" : "th")))
                       << " state in eV: ";
             getterLoop(std::cin, std::cout, this->E[i], "Please enter a numerical value: ");
+            this->TOTAL_POTENTIAL[i] = 0.0;
         }
     }
 
@@ -231,6 +337,37 @@ Thermodynamics::SystemParameters<Num>& Thermodynamics::SystemParameters<Num>::ac
     return *this;
 }
 
+/**
+ * acquire the number of particles in each state from user input
+ * @return              itself, by reference
+ */
+template <typename Num>
+Thermodynamics::SystemParameters<Num>& Thermodynamics::SystemParameters<Num>::acquire_occupancy(void) {
+    delete [] this->OCCUPANCY;
+    this->OCCUPANCY = new Num[this->n];
+
+    for (unsigned short int i = 0; i < this->n; i++) {
+        std::cout << "Enter the number of particles in state " << i+1 << ": ";
+        rangedGetterLoop(std::cin, std::cout, this->OCCUPANCY[i], static_cast<Num>(0),
+                         static_cast<Num>(std::numeric_limits<unsigned int>::max()),
+                         "Please enter a nonnegative number: ");
+    }
+
+    return *this;
+}
+
+/**
+ * set the chemical potential per particle and the total chemical potential of each state from it
+ * @param potential     (eV) the chemical potential per particle
+ */
+template <typename Num>
+void Thermodynamics::SystemParameters<Num>::set_potential(const Num potential) {
+    this->POTENTIAL = potential;
+    for (unsigned short int i = 0; i < this->n; i++) {
+        this->TOTAL_POTENTIAL[i] = this->occupancy(i) * potential;
+    }
+}
+
 ///////////////////////////////////
 /* class PartitionFunctionSample */
 
@@ -239,11 +376,16 @@ Thermodynamics::SystemParameters<Num>& Thermodynamics::SystemParameters<Num>::ac
  */
 template <typename Num>
 Thermodynamics::PartitionFunctionSample<Num>::~PartitionFunctionSample(void) {
-    delete [] this->P;
+    delete [] this->W;
     delete [] this->TOTAL_POTENTIAL;
-    this->P = nullptr;
+    delete [] this->Z_SINGLE;
+    delete [] this->Z_CANONICAL;
+    delete [] this->W_POWER;
+    this->W = nullptr;
     this->TOTAL_POTENTIAL = nullptr;
+    this->Z_SINGLE = this->Z_CANONICAL = this->W_POWER = nullptr;
     this->states = 0;
+    this->n_particles = 0;
 }
 
 /**
@@ -251,8 +393,12 @@ Thermodynamics::PartitionFunctionSample<Num>::~PartitionFunctionSample(void) {
  */
 template <typename Num>
 Thermodynamics::PartitionFunctionSample<Num>::PartitionFunctionSample(void) {
-    this->TAU = this->PARTITION = 0.0;
-    this->P = nullptr;
+    this->TAU = this->BETA = this->PARTITION = 0.0;
+    this->POTENTIAL = this->N_SUM = this->N2_SUM = 0.0;
+    this->updates = 0;
+    this->n_particles = 0;
+    this->Z_SINGLE = this->Z_CANONICAL = this->W_POWER = nullptr;
+    this->W = nullptr;
     this->TOTAL_POTENTIAL = nullptr;
     this->states = 0;
 }
@@ -262,12 +408,16 @@ Thermodynamics::PartitionFunctionSample<Num>::PartitionFunctionSample(void) {
  */
 template <typename Num>
 Thermodynamics::PartitionFunctionSample<Num>::PartitionFunctionSample(const unsigned int numstates) {
-    this->TAU = this->PARTITION = 0.0;
-    this->P = new Num[numstates];
+    this->TAU = this->BETA = this->PARTITION = 0.0;
+    this->POTENTIAL = this->N_SUM = this->N2_SUM = 0.0;
+    this->updates = 0;
+    this->n_particles = 0;
+    this->Z_SINGLE = this->Z_CANONICAL = this->W_POWER = nullptr;
+    this->W = new Num[numstates];
     this->TOTAL_POTENTIAL = new Num[numstates];
     this->states = numstates;
     for (unsigned int i = 0; i < this->states; i++) {
-        this->P[i] = this->TOTAL_POTENTIAL = 0.0;
+        this->W[i] = this->TOTAL_POTENTIAL[i] = 0.0;
     }
 }
 
@@ -277,19 +427,178 @@ Thermodynamics::PartitionFunctionSample<Num>::PartitionFunctionSample(const unsi
  */
 template <typename Num>
 void Thermodynamics::PartitionFunctionSample<Num>::calculate(SystemParameters<Num>& params) {
-    this->TEMPERATURE = params.T();
+    this->calculate(params, params.T());
+}
+
+/**
+ * calculate the values at the given state energies and an explicit temperature, so that
+ * several samples can share one set of parameters from different threads
+ * @param params        system parameters
+ * @param temperature   (K) the temperature
+ */
+template <typename Num>
+void Thermodynamics::PartitionFunctionSample<Num>::calculate(const SystemParameters<Num>& params, const Num temperature) {
+    this->TEMPERATURE = temperature;
     this->TAU = Constants::k_B * this->TEMPERATURE;
-    // calculate the partition function; Z(tau) == \Sum_{j=0}^{\Infinity} \exp{(\mu - E) / \tau}
+    this->BETA = 1 / this->TAU;
+    this->POTENTIAL = params.potential();
+    // this is just for bookkeeping purposes
     for (unsigned int i = 0; i < this->states; i++) {
-        this->P[i] = exp((params.mu(i) - params.energy(i)) / this->TAU);
-        this->PARTITION += this->P[i];
-        // this is just for bookkeeping purposes
         this->TOTAL_POTENTIAL[i] = params.mu(i);
     }
-    // divide by Z to get the probability for each state
-    for (unsigned int i = 0; i < this->states; i++) {
-        this->P[i] /= this->PARTITION;
+    // keep the un-normalized weights so single states can be updated later; P_i normalizes on demand.
+    // The weights are left unshifted so Z and the incremental updates stay absolute, which relies on
+    // the exponent range of the multiprecision type
+    this->PARTITION = boltzmannSums(params.energies(), params.potentials(), params.occupancies(), this->states,
+                                    this->BETA, static_cast<Num>(0), this->W, this->N_SUM, this->N2_SUM);
+    this->updates = 0;
+}
+
+/**
+ * calculate the canonical partition functions of up to N identical particles, reusing the
+ * single-particle weights; states are weighted by exp((mu - E) / tau) as in calculate()
+ * @param params        system parameters
+ * @param temperature   (K) the temperature
+ * @param N             the number of particles
+ * @param stats         whether the particles are bosons or fermions
+ */
+template <typename Num>
+void Thermodynamics::PartitionFunctionSample<Num>::calculate_canonical(const SystemParameters<Num>& params, const Num temperature,
+                                                                       const unsigned short int N, const Statistics stats) {
+    this->calculate(params, temperature);
+    // allocated once and reused as long as the number of particles stays the same
+    if (this->Z_CANONICAL == nullptr || this->n_particles != N) {
+        delete [] this->Z_SINGLE;
+        delete [] this->Z_CANONICAL;
+        this->Z_SINGLE = new Num[N + 1];
+        this->Z_CANONICAL = new Num[N + 1];
+        this->n_particles = N;
+    }
+    if (this->W_POWER == nullptr) {
+        this->W_POWER = new Num[this->states];
+    }
+    canonicalPartitions(static_cast<const Num*>(this->W), this->states, N, stats, this->W_POWER,
+                        this->Z_SINGLE, this->Z_CANONICAL);
+}
+
+/**
+ * recalculate a single state's weight after its energy or total chemical potential has changed,
+ * updating Z without touching the other states; the chemical potential per particle is not re-solved
+ * @param params        system parameters holding the new energy, total chemical potential and particle number
+ * @param i             the index of the changed state
+ */
+template <typename Num>
+void Thermodynamics::PartitionFunctionSample<Num>::update_state(const SystemParameters<Num>& params, const unsigned short int i) {
+    if (i >= this->states) {
+        return;
+    }
+    const Num old_Z = this->PARTITION;
+    const Num old_W = this->W[i];
+    // in the grand canonical mode each sample has its own solved chemical potential
+    this->TOTAL_POTENTIAL[i] = (params.grand_canonical() ? params.occupancy(i) * this->POTENTIAL : params.mu(i));
+    this->W[i] = exp((this->TOTAL_POTENTIAL[i] - params.energy(i)) * this->BETA);
+    this->PARTITION += this->W[i] - old_W;
+    this->N_SUM += params.occupancy(i) * (this->W[i] - old_W);
+    this->N2_SUM += params.occupancy(i) * params.occupancy(i) * (this->W[i] - old_W);
+    this->updates++;
+    // sum from scratch periodically, or whenever a dominant term was removed and the subtraction lost digits
+    if (this->updates >= refresh_interval || this->PARTITION < old_Z / 2) {
+        this->resum(params);
+    }
+}
+
+/**
+ * sum Z and the particle number sums from the stored weights, discarding accumulated rounding error
+ * @param params        system parameters holding the particle numbers
+ */
+template <typename Num>
+void Thermodynamics::PartitionFunctionSample<Num>::resum(const SystemParameters<Num>& params) {
+    this->PARTITION = this->N_SUM = this->N2_SUM = 0.0;
+    for (unsigned int j = 0; j < this->states; j++) {
+        this->PARTITION += this->W[j];
+        this->N_SUM += params.occupancy(j) * this->W[j];
+        this->N2_SUM += params.occupancy(j) * params.occupancy(j) * this->W[j];
+    }
+    this->updates = 0;
+}
+
+/**
+ * find the chemical potential per particle that gives a target mean number of particles
+ * using Newton's method, falling back to bisection whenever a step leaves the bracket
+ * @param params        system parameters; the solved potential is left set in them
+ * @param target        the desired mean number of particles
+ * @param guess         (eV) the starting chemical potential, e.g. the solution at the previous temperature
+ * @param tolerance     the largest acceptable absolute error in the mean number of particles
+ * @return              whether or not the solver converged
+ */
+template <typename Num>
+bool Thermodynamics::PartitionFunctionSample<Num>::solve_mu(SystemParameters<Num>& params, const Num target,
+                                                            const Num guess, const Num tolerance) {
+    const unsigned int max_iterations = 200;
+    // <N> is bounded by the smallest and largest particle numbers, so the target must lie between them
+    Num N_min = params.occupancy(0), N_max = params.occupancy(0);
+    for (unsigned short int i = 1; i < params.states(); i++) {
+        if (params.occupancy(i) < N_min) N_min = params.occupancy(i);
+        if (params.occupancy(i) > N_max) N_max = params.occupancy(i);
+    }
+    if (params.states() == 0 || target <= N_min || target >= N_max) {
+        // still fill in the sample so its temperature and Z are real
+        params.set_potential(guess);
+        this->calculate(params);
+        return false;
+    }
+
+    Num mu = guess, lo = 0.0, hi = 0.0;
+    bool have_lo = false, have_hi = false;
+    Num step = Constants::k_B * params.T();
+    for (unsigned int iter = 0; iter < max_iterations; iter++) {
+        params.set_potential(mu);
+        this->calculate(params);
+        Num residual = this->N() - target;
+        if (abs(residual) <= tolerance) {
+            return true;
+        }
+        // <N> increases monotonically with mu, so each evaluation tightens one side of the bracket
+        if (residual < 0) {
+            lo = mu;
+            have_lo = true;
+        }
+        else {
+            hi = mu;
+            have_hi = true;
+        }
+
+        Num slope = this->dN_dmu();
+        Num next = mu;
+        bool newton = slope > 0;
+        if (newton) {
+            next = mu - residual / slope;
+            if (have_lo && have_hi) {
+                newton = next > lo && next < hi;
+            }
+            // limit the step until both sides of the root are known
+            else if (abs(next - mu) > step) {
+                next = (residual < 0 ? mu + step : mu - step);
+                step *= 2;
+            }
+        }
+        if (!newton) {
+            if (have_lo && have_hi) {
+                next = (lo + hi) / 2;
+            }
+            else {
+                next = (residual < 0 ? mu + step : mu - step);
+                step *= 2;
+            }
+        }
+        // the bracket has collapsed to the working precision
+        if (next == mu) {
+            return abs(residual) <= tolerance;
+        }
+        mu = next;
     }
+
+    return false;
 }
 
 /**
@@ -298,11 +607,14 @@ void Thermodynamics::PartitionFunctionSample<Num>::calculate(SystemParameters<Nu
  */
 template <typename Num>
 void Thermodynamics::PartitionFunctionSample<Num>::initialize(const unsigned short int i) {
-    this->P = new Num[i];
+    this->W = new Num[i];
     this->TOTAL_POTENTIAL = new Num[i];
+    // the canonical scratch array is sized by the number of states
+    delete [] this->W_POWER;
+    this->W_POWER = nullptr;
     this->states = i;
     for (unsigned int j = 0; j < this->states; j++) {
-        this->P[j] = this->TOTAL_POTENTIAL[j] = 0.0;
+        this->W[j] = this->TOTAL_POTENTIAL[j] = 0.0;
     }
 }
 
@@ -338,6 +650,22 @@ void Thermodynamics::SystemManager<Num>::initialize(const unsigned short int n_s
     }
 }
 
+/**
+ * change the energy of one state and update every sample without recalculating the other states
+ * @param i             the index of the state
+ * @param energy        (eV) the new energy
+ */
+template <typename Num>
+void Thermodynamics::SystemManager<Num>::update_state(const unsigned short int i, const Num energy) {
+    if (i >= this->params.states()) {
+        return;
+    }
+    this->params.set_energy(i, energy);
+    for (unsigned short j = 0; j < this->number_of_samples; j++) {
+        this->sample[j].update_state(this->params, i);
+    }
+}
+
 /**
  * save the results to disk
  * @param filename      The name of the save file
@@ -350,6 +678,12 @@ bool Thermodynamics::SystemManager<Num>::save_to_disk(const std::string filename
     if (file.is_open()) {
         // output the heading
         file << std::setprecision(16) << "All energies are in eV\n\nT (K),tau,Z(tau)";
+        if (this->params.grand_canonical()) {
+            file << ",mu,<N>";
+        }
+        if (this->n_samp() > 0 && sample[0].particles() > 0) {
+            file << ",Z_" << sample[0].particles() << "(tau)";
+        }
         for (unsigned int i = 0; i < this->params.states(); i++) {
             file << ",P_" << i+1 << "(tau)";
         }
@@ -360,6 +694,13 @@ bool Thermodynamics::SystemManager<Num>::save_to_disk(const std::string filename
             file << sample[i].T()   << ',' // temp
                  << sample[i].tau() << ',' // fundamental temp / thermal energy
                  << sample[i].Z();         // partition function
+            if (this->params.grand_canonical()) {
+                file << ',' << sample[i].mu()  // chemical potential per particle
+                     << ',' << sample[i].N();  // mean number of particles
+            }
+            if (sample[i].particles() > 0) {
+                file << ',' << sample[i].Z_N(sample[i].particles()); // canonical partition function
+            }
             for (unsigned int j = 0; j < this->params.states(); j++) {
                 file << ',' << sample[i].P_i(j); // output the probabilities
             }
@@ -373,6 +714,158 @@ bool Thermodynamics::SystemManager<Num>::save_to_disk(const std::string filename
     return success;
 }
 
+//////////////////////////
+/* class SystemEnsemble */
+
+/**
+ * destructor
+ */
+template <typename Num>
+Thermodynamics::SystemEnsemble<Num>::~SystemEnsemble(void) {
+    delete [] this->params;
+    delete [] this->n;
+    delete [] this->E;
+    delete [] this->TOTAL_POTENTIAL;
+    delete [] this->TEMPERATURE;
+    delete [] this->TAU;
+    delete [] this->LN_PARTITION;
+    delete [] this->P;
+}
+
+/**
+ * default constructor
+ */
+template <typename Num>
+Thermodynamics::SystemEnsemble<Num>::SystemEnsemble(void) {
+    this->params = nullptr;
+    this->n = nullptr;
+    this->E = this->TOTAL_POTENTIAL = nullptr;
+    this->TEMPERATURE = this->TAU = this->LN_PARTITION = this->P = nullptr;
+}
+
+/**
+ * acquire the parameters of every system from their config files or user input
+ * @param systems       the number of systems
+ * @return              itself, by reference
+ */
+template <typename Num>
+Thermodynamics::SystemEnsemble<Num>& Thermodynamics::SystemEnsemble<Num>::acquire(const unsigned short int systems) {
+    std::string cfg_name;
+
+    std::cout << "\nEnter a filename to save the combined results (CSV format, will be overwritten): ";
+    std::getline(std::cin, this->filename);
+
+    delete [] this->params;
+    this->params = new SystemParameters<Num>[systems];
+    this->K = systems;
+    for (unsigned short int k = 0; k < this->K; k++) {
+        std::cout << "\nEnter the configuration file name for system " << k+1 << ": ";
+        std::getline(std::cin, cfg_name);
+        // the ensemble saves every system to one combined file
+        this->params[k].acquire(cfg_name, false);
+    }
+
+    return *this;
+}
+
+/**
+ * interleave the systems' states into shared arrays and allocate the result arrays
+ * @param n_samp        the number of temperature samples
+ */
+template <typename Num>
+void Thermodynamics::SystemEnsemble<Num>::initialize(const unsigned short int n_samp) {
+    delete [] this->n;
+    this->n = new unsigned short int[this->K];
+    this->n_max = 0;
+    for (unsigned short int k = 0; k < this->K; k++) {
+        this->n[k] = this->params[k].states();
+        if (this->n[k] > this->n_max) {
+            this->n_max = this->n[k];
+        }
+    }
+
+    // state j of every system sits side by side, padded with zeros up to the largest system
+    const std::size_t row_size = static_cast<std::size_t>(this->n_max) * this->K;
+    delete [] this->E;
+    delete [] this->TOTAL_POTENTIAL;
+    this->E = new Num[row_size];
+    this->TOTAL_POTENTIAL = new Num[row_size];
+    for (unsigned short int i = 0; i < this->n_max; i++) {
+        for (unsigned short int k = 0; k < this->K; k++) {
+            this->E[static_cast<std::size_t>(i) * this->K + k] = this->params[k].energy(i);
+            this->TOTAL_POTENTIAL[static_cast<std::size_t>(i) * this->K + k] = this->params[k].mu(i);
+        }
+    }
+
+    delete [] this->TEMPERATURE;
+    delete [] this->TAU;
+    delete [] this->LN_PARTITION;
+    delete [] this->P;
+    this->number_of_samples = n_samp;
+    this->TEMPERATURE = new Num[n_samp];
+    this->TAU = new Num[n_samp];
+    this->LN_PARTITION = new Num[static_cast<std::size_t>(n_samp) * this->K];
+    this->P = new Num[static_cast<std::size_t>(n_samp) * row_size];
+}
+
+/**
+ * calculate every system at every temperature of the grid
+ * @param T_min         (K) the first temperature
+ * @param T_step        (K) the spacing between temperatures
+ * @param threads       the number of threads to use; 0 uses every hardware thread
+ */
+template <typename Num>
+void Thermodynamics::SystemEnsemble<Num>::calculate(const Num T_min, const Num T_step, const unsigned int threads) {
+    for (unsigned short int i = 0; i < this->number_of_samples; i++) {
+        this->TEMPERATURE[i] = T_min + T_step * i;
+    }
+    evaluateSystems(static_cast<const Num*>(this->E), static_cast<const Num*>(this->TOTAL_POTENTIAL),
+                    static_cast<const unsigned short int*>(this->n), this->K, this->n_max,
+                    static_cast<const Num*>(this->TEMPERATURE), this->number_of_samples,
+                    static_cast<Num>(Constants::k_B), this->TAU, this->LN_PARTITION, this->P, threads);
+}
+
+/**
+ * save the combined results of every system to disk
+ * @param filename      The name of the save file
+ * @return              whether or not the save was successful
+ */
+template <typename Num>
+bool Thermodynamics::SystemEnsemble<Num>::save_to_disk(const std::string filename) {
+    bool success = true;
+    std::ofstream file(filename.c_str(), std::ofstream::out);
+    if (file.is_open()) {
+        // output the heading; system k's columns are suffixed with its number
+        file << std::setprecision(16) << "All energies are in eV\n\nT (K),tau";
+        for (unsigned short int k = 0; k < this->K; k++) {
+            file << ",Z[" << k+1 << "](tau)";
+            for (unsigned short int i = 0; i < this->n[k]; i++) {
+                file << ",P_" << i+1 << "[" << k+1 << "](tau)";
+            }
+        }
+        file << '\n'; // start on the next row
+
+        // output the data for each sample
+        for (unsigned int t = 0; t < this->n_samp(); t++) {
+            file << this->TEMPERATURE[t] << ',' // temp
+                 << this->TAU[t];               // fundamental temp / thermal energy
+            const Num* P_row = this->P + static_cast<std::size_t>(t) * this->n_max * this->K;
+            for (unsigned short int k = 0; k < this->K; k++) {
+                file << ',' << exp(this->LN_PARTITION[static_cast<std::size_t>(t) * this->K + k]); // partition function
+                for (unsigned short int i = 0; i < this->n[k]; i++) {
+                    file << ',' << P_row[static_cast<std::size_t>(i) * this->K + k]; // output the probabilities
+                }
+            }
+            file << '\n'; // next row
+        }
+    }
+    else {
+        success = false;
+    }
+
+    return success;
+}
+
 ///////////////////////
 /* class progressBar */
 
@@ -0,0 +1,419 @@
+/**
+ * Fitting of state energies and chemical potentials to measured data
+ */
+
+#ifndef FITTING_HPP
+    #define FITTING_HPP
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include "hpmath.hpp"
+#include "templates.hpp"
+#include "classes.hpp"
+
+namespace Thermodynamics {
+    /**
+     * fits the energies and total chemical potentials of a system's states to measured heat capacities
+     * and state populations with a Levenberg-Marquardt solver
+     */
+    template <typename Num>
+    class LevelFitter {
+        //! number of data points
+        unsigned int m = 0;
+        //! number of distinct temperatures in the data
+        unsigned int n_temps = 0;
+        //! number of fitted parameters; the n energies followed by the n total chemical potentials
+        unsigned int n_params = 0;
+        //! (K) owning pointer to the temperature of each data point
+        Num* T_DATA;
+        //! owning pointer to the measured value of each data point
+        Num* VALUE;
+        //! owning pointer to the state of each population data point; -1 for heat capacities
+        int* STATE;
+        //! owning pointer to the index of each data point's temperature in the sample array
+        unsigned int* TEMP_INDEX;
+        //! owning pointer to the model value of each data point
+        Num* MODEL;
+        //! owning pointer to the residuals (model - measured)
+        Num* RESIDUAL;
+        //! owning pointer to the row-major m by n_params Jacobian of the residuals
+        Num* JACOBIAN;
+        //! owning pointer to one sample per distinct temperature
+        PartitionFunctionSample<Num>* sample;
+        void get_parameters(const SystemParameters<Num>&, Num*) const;
+        void set_parameters(SystemParameters<Num>&, const Num*) const;
+      public:
+        //! the fitted system's parameters
+        SystemParameters<Num>* params;
+        ~LevelFitter(void);
+        LevelFitter(void);
+        //! return the number of data points
+        unsigned int points(void) const {return this->m;}
+        bool load(const std::string, SystemParameters<Num>&);
+        Num evaluate(void);
+        unsigned int solve(const unsigned int, std::ostream&);
+        bool save_to_disk(std::string);
+    };
+}
+
+///////////////////////
+/* class LevelFitter */
+
+/**
+ * destructor
+ */
+template <typename Num>
+Thermodynamics::LevelFitter<Num>::~LevelFitter(void) {
+    delete [] this->T_DATA;
+    delete [] this->VALUE;
+    delete [] this->STATE;
+    delete [] this->TEMP_INDEX;
+    delete [] this->MODEL;
+    delete [] this->RESIDUAL;
+    delete [] this->JACOBIAN;
+    delete [] this->sample;
+    this->params = nullptr;
+}
+
+/**
+ * default constructor
+ */
+template <typename Num>
+Thermodynamics::LevelFitter<Num>::LevelFitter(void) {
+    this->T_DATA = this->VALUE = this->MODEL = this->RESIDUAL = this->JACOBIAN = nullptr;
+    this->STATE = nullptr;
+    this->TEMP_INDEX = nullptr;
+    this->sample = nullptr;
+    this->params = nullptr;
+}
+
+/**
+ * load the target dataset; each line is either "T C value" for a heat capacity in units of k_B
+ * or "T P i value" for the population of state i (counting from 1)
+ * @param data_name     the name of the data file
+ * @param system        the parameters to fit, which also give the starting values
+ * @return              whether or not the file was read successfully
+ */
+template <typename Num>
+bool Thermodynamics::LevelFitter<Num>::load(const std::string data_name, SystemParameters<Num>& system) {
+    std::ifstream data(data_name);
+    std::string line;
+    if (!data.is_open()) {
+        return false;
+    }
+    this->params = &system;
+
+    // count the data points first so every array can be allocated once
+    this->m = 0;
+    while (std::getline(data, line)) {
+        if (line.find_first_not_of(" \t\r") != std::string::npos) {
+            this->m++;
+        }
+    }
+    data.clear();
+    data.seekg(0);
+
+    delete [] this->T_DATA;
+    delete [] this->VALUE;
+    delete [] this->STATE;
+    delete [] this->TEMP_INDEX;
+    this->T_DATA = new Num[this->m];
+    this->VALUE = new Num[this->m];
+    this->STATE = new int[this->m];
+    this->TEMP_INDEX = new unsigned int[this->m];
+
+    // read the points, collecting the distinct temperatures in order of appearance
+    Num* distinct = new Num[this->m];
+    this->n_temps = 0;
+    unsigned int k = 0;
+    bool success = true;
+    while (k < this->m && std::getline(data, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        std::istringstream fields(line);
+        char kind = 0;
+        int state = 0;
+        fields >> this->T_DATA[k] >> kind;
+        if (this->T_DATA[k] <= 0) {
+            success = false;
+        }
+        if (tolower(kind) == 'p') {
+            fields >> state;
+            if (state < 1 || state > system.states()) {
+                success = false;
+            }
+            this->STATE[k] = state - 1;
+        }
+        else if (tolower(kind) == 'c') {
+            this->STATE[k] = -1;
+        }
+        else {
+            success = false;
+        }
+        fields >> this->VALUE[k];
+        if (fields.fail()) {
+            success = false;
+        }
+
+        unsigned int t = 0;
+        while (t < this->n_temps && distinct[t] != this->T_DATA[k]) {
+            t++;
+        }
+        if (t == this->n_temps) {
+            distinct[this->n_temps++] = this->T_DATA[k];
+        }
+        this->TEMP_INDEX[k] = t;
+        k++;
+    }
+    data.close();
+
+    // one sample per distinct temperature; every data point at that temperature reuses its weights
+    delete [] this->sample;
+    this->sample = new PartitionFunctionSample<Num>[this->n_temps];
+    for (unsigned int t = 0; t < this->n_temps; t++) {
+        this->sample[t].initialize(system.states());
+        this->sample[t].calculate(system, distinct[t]);
+    }
+    delete [] distinct;
+
+    this->n_params = 2 * static_cast<unsigned int>(system.states());
+    delete [] this->MODEL;
+    delete [] this->RESIDUAL;
+    delete [] this->JACOBIAN;
+    this->MODEL = new Num[this->m];
+    this->RESIDUAL = new Num[this->m];
+    this->JACOBIAN = new Num[static_cast<std::size_t>(this->m) * this->n_params];
+
+    return success && this->m > 0;
+}
+
+/**
+ * calculate every residual and its analytic derivatives with respect to each energy and total chemical
+ * potential; the distinct temperatures and then the data points are split between threads
+ * @return              the sum of the squared residuals
+ */
+template <typename Num>
+Num Thermodynamics::LevelFitter<Num>::evaluate(void) {
+    const SystemParameters<Num>& system = *(this->params);
+    const unsigned short int n = system.states();
+
+    parallelFor(this->n_temps, 0, [&](const unsigned int first, const unsigned int last) {
+        for (unsigned int t = first; t < last; t++) {
+            this->sample[t].calculate(system, this->sample[t].T());
+        }
+    });
+
+    // every row depends only on its own temperature's sample, so the rows are independent
+    parallelFor(this->m, 0, [&](const unsigned int first, const unsigned int last) {
+        for (unsigned int k = first; k < last; k++) {
+            const PartitionFunctionSample<Num>& s = this->sample[this->TEMP_INDEX[k]];
+            const Num beta = 1 / s.tau();
+            Num* row = this->JACOBIAN + static_cast<std::size_t>(k) * this->n_params;
+            if (this->STATE[k] < 0) {
+                // C / k_B == \beta^2 Var(\epsilon), with \epsilon_j == E_j - \mu_j
+                Num mean = 0.0, variance = 0.0;
+                for (unsigned short int j = 0; j < n; j++) {
+                    mean += s.P_i(j) * (system.energy(j) - s.mu_i(j));
+                }
+                for (unsigned short int j = 0; j < n; j++) {
+                    Num d = system.energy(j) - s.mu_i(j) - mean;
+                    variance += s.P_i(j) * d * d;
+                }
+                this->MODEL[k] = beta * beta * variance;
+                // dC/dE_j == \beta^2 P_j (2 d_j - \beta (d_j^2 - Var(\epsilon))), and dC/d\mu_j is its negative
+                for (unsigned short int j = 0; j < n; j++) {
+                    Num d = system.energy(j) - s.mu_i(j) - mean;
+                    row[j] = beta * beta * s.P_i(j) * (2 * d - beta * (d * d - variance));
+                    row[n + j] = -row[j];
+                }
+            }
+            else {
+                // dP_i/dE_j == -\beta P_i (\delta_ij - P_j), and dP_i/d\mu_j is its negative
+                const unsigned short int i = static_cast<unsigned short int>(this->STATE[k]);
+                const Num P = s.P_i(i);
+                this->MODEL[k] = P;
+                for (unsigned short int j = 0; j < n; j++) {
+                    row[j] = -beta * P * ((i == j ? 1 : 0) - s.P_i(j));
+                    row[n + j] = -row[j];
+                }
+            }
+            this->RESIDUAL[k] = this->MODEL[k] - this->VALUE[k];
+        }
+    });
+
+    Num cost = 0.0;
+    for (unsigned int k = 0; k < this->m; k++) {
+        cost += this->RESIDUAL[k] * this->RESIDUAL[k];
+    }
+
+    return cost;
+}
+
+/**
+ * copy the energies and total chemical potentials into a parameter vector
+ * @param system        the system parameters
+ * @param x             output parameter vector of length n_params
+ */
+template <typename Num>
+void Thermodynamics::LevelFitter<Num>::get_parameters(const SystemParameters<Num>& system, Num* x) const {
+    const unsigned short int n = system.states();
+    for (unsigned short int j = 0; j < n; j++) {
+        x[j] = system.energy(j);
+        x[n + j] = system.mu(j);
+    }
+}
+
+/**
+ * copy a parameter vector into the energies and total chemical potentials
+ * @param system        the system parameters
+ * @param x             parameter vector of length n_params
+ */
+template <typename Num>
+void Thermodynamics::LevelFitter<Num>::set_parameters(SystemParameters<Num>& system, const Num* x) const {
+    const unsigned short int n = system.states();
+    for (unsigned short int j = 0; j < n; j++) {
+        system.set_energy(j, x[j]);
+        system.set_mu(j, x[n + j]);
+    }
+}
+
+/**
+ * fit the parameters with the Levenberg-Marquardt method; the data only depend on E_j - mu_j, and
+ * the damping keeps the steps finite along the directions the data cannot resolve
+ * @param max_iterations        the largest number of accepted steps
+ * @param log                   stream to report progress to
+ * @return                      the number of accepted steps
+ */
+template <typename Num>
+unsigned int Thermodynamics::LevelFitter<Num>::solve(const unsigned int max_iterations, std::ostream& log) {
+    const unsigned int p = this->n_params;
+    Num* x = new Num[p];
+    Num* trial = new Num[p];
+    Num* JtJ = new Num[static_cast<std::size_t>(p) * p];
+    Num* A = new Num[static_cast<std::size_t>(p) * p];
+    Num* g = new Num[p];
+    Num* step = new Num[p];
+    Num lambda = static_cast<Num>(1e-3);
+    unsigned int accepted = 0;
+
+    this->get_parameters(*(this->params), x);
+    Num cost = this->evaluate();
+    log << "Initial sum of squares: " << cost << '\n';
+
+    for (unsigned int iter = 0; iter < max_iterations; iter++) {
+        // normal equations J^T J and J^T r from the current Jacobian; row a has p - a entries on or
+        // above the diagonal, so row q is paired with row p - 1 - q to give every pair the same work.
+        // Row a writes only entries (a, b) and (b, a) with b >= a, so no two threads touch the same entry
+        parallelFor((p + 1) / 2, 0, [&](const unsigned int first, const unsigned int last) {
+            for (unsigned int q = first; q < last; q++) {
+                const unsigned int rows[2] = {q, p - 1 - q};
+                for (unsigned int r = 0; r < (rows[1] > rows[0] ? 2u : 1u); r++) {
+                    const unsigned int a = rows[r];
+                    g[a] = 0.0;
+                    for (unsigned int b = a; b < p; b++) {
+                        Num sum = 0.0;
+                        for (unsigned int k = 0; k < this->m; k++) {
+                            sum += this->JACOBIAN[static_cast<std::size_t>(k) * p + a] * this->JACOBIAN[static_cast<std::size_t>(k) * p + b];
+                        }
+                        JtJ[a * p + b] = JtJ[b * p + a] = sum;
+                    }
+                    for (unsigned int k = 0; k < this->m; k++) {
+                        g[a] += this->JACOBIAN[static_cast<std::size_t>(k) * p + a] * this->RESIDUAL[k];
+                    }
+                }
+            }
+        });
+
+        // raise the damping until a step lowers the sum of squares
+        bool improved = false;
+        Num trial_cost = cost;
+        while (!improved && lambda < static_cast<Num>(1e12)) {
+            for (unsigned int a = 0; a < p; a++) {
+                for (unsigned int b = 0; b < p; b++) {
+                    A[a * p + b] = JtJ[a * p + b];
+                }
+                A[a * p + a] += lambda * (JtJ[a * p + a] > 0 ? JtJ[a * p + a] : static_cast<Num>(1));
+                step[a] = -g[a];
+            }
+            if (solveLinearSystem(A, step, p)) {
+                for (unsigned int a = 0; a < p; a++) {
+                    trial[a] = x[a] + step[a];
+                }
+                this->set_parameters(*(this->params), trial);
+                trial_cost = this->evaluate();
+                improved = trial_cost < cost;
+            }
+            if (!improved) {
+                lambda *= 10;
+            }
+        }
+
+        if (!improved) {
+            // no step helps; put back the best parameters and their residuals
+            this->set_parameters(*(this->params), x);
+            this->evaluate();
+            break;
+        }
+        accepted++;
+        lambda /= 10;
+        const Num reduction = cost - trial_cost;
+        cost = trial_cost;
+        for (unsigned int a = 0; a < p; a++) {
+            x[a] = trial[a];
+        }
+        log << "Iteration " << accepted << ": sum of squares = " << cost << '\n';
+        if (reduction <= static_cast<Num>(1e-12) * cost || cost == 0) {
+            break;
+        }
+    }
+
+    delete [] x;
+    delete [] trial;
+    delete [] JtJ;
+    delete [] A;
+    delete [] g;
+    delete [] step;
+
+    return accepted;
+}
+
+/**
+ * save the fitted parameters and the fitted data to disk
+ * @param filename      The name of the save file
+ * @return              whether or not the save was successful
+ */
+template <typename Num>
+bool Thermodynamics::LevelFitter<Num>::save_to_disk(const std::string filename) {
+    bool success = true;
+    std::ofstream file(filename.c_str(), std::ofstream::out);
+    if (file.is_open()) {
+        file << std::setprecision(16) << "All energies are in eV; heat capacities are in units of k_B\n\nState,E,mu\n";
+        for (unsigned short int j = 0; j < this->params->states(); j++) {
+            file << j+1 << ',' << this->params->energy(j) << ',' << this->params->mu(j) << '\n';
+        }
+
+        file << "\nT (K),quantity,target,fit,residual\n";
+        for (unsigned int k = 0; k < this->m; k++) {
+            file << this->T_DATA[k] << ',';
+            if (this->STATE[k] < 0) {
+                file << 'C';
+            }
+            else {
+                file << "P_" << this->STATE[k] + 1;
+            }
+            file << ',' << this->VALUE[k] << ',' << this->MODEL[k] << ',' << this->RESIDUAL[k] << '\n';
+        }
+    }
+    else {
+        success = false;
+    }
+
+    return success;
+}
+
+#endif
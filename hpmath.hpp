@@ -6,6 +6,7 @@
     #define HPMATH_HPP
 
 #include <cmath>
+#include <limits>
 
 //////////////////////////////
 ///// Function Templates /////
@@ -100,4 +101,66 @@ Numerical tetrate(const Numerical base, const int hyperpower) {
     return result;
 }
 
+/*
+ * check that a number is neither infinite nor NaN
+ * @param x             the number to check
+ * @return              whether or not x is finite
+ */
+template <typename Numerical>
+bool isFinite(const Numerical x) {
+    // x - x is 0 for finite x and NaN for infinities and NaN, and NaN never compares equal
+    Numerical zero = x - x;
+    return zero == zero;
+}
+
+/*
+ * solve the linear system A x == b by Gaussian elimination with partial pivoting
+ * @param A             row-major n by n matrix; overwritten
+ * @param b             right-hand side of length n; overwritten with the solution
+ * @param n             the size of the system
+ * @return              whether or not the matrix was nonsingular
+ */
+template <typename Numerical>
+bool solveLinearSystem(Numerical* A, Numerical* b, const unsigned int n) {
+    for (unsigned int col = 0; col < n; col++) {
+        // bring the largest remaining entry of this column onto the diagonal
+        unsigned int pivot = col;
+        for (unsigned int row = col + 1; row < n; row++) {
+            if (abs(A[row * n + col]) > abs(A[pivot * n + col])) {
+                pivot = row;
+            }
+        }
+        if (A[pivot * n + col] == 0) {
+            return false;
+        }
+        if (pivot != col) {
+            for (unsigned int j = 0; j < n; j++) {
+                Numerical swap = A[col * n + j];
+                A[col * n + j] = A[pivot * n + j];
+                A[pivot * n + j] = swap;
+            }
+            Numerical swap = b[col];
+            b[col] = b[pivot];
+            b[pivot] = swap;
+        }
+        // eliminate below the diagonal
+        for (unsigned int row = col + 1; row < n; row++) {
+            Numerical factor = A[row * n + col] / A[col * n + col];
+            for (unsigned int j = col; j < n; j++) {
+                A[row * n + j] -= factor * A[col * n + j];
+            }
+            b[row] -= factor * b[col];
+        }
+    }
+    // back substitution
+    for (unsigned int i = n; i-- > 0;) {
+        for (unsigned int j = i + 1; j < n; j++) {
+            b[i] -= A[i * n + j] * b[j];
+        }
+        b[i] /= A[i * n + i];
+    }
+
+    return true;
+}
+
 #endif
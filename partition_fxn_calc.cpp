@@ -17,6 +17,7 @@
     using namespace boost::multiprecision;
 
 #include "classes.hpp"
+#include "fitting.hpp"
 
 enum MenuChoice {
     varyTemp,
@@ -25,33 +26,78 @@ enum MenuChoice {
     quit
 };
 
+template <typename Num>
+unsigned short int getTemperatureRange(Num&, Num&);
 template <typename Num>
 void sweepTemperature(Thermodynamics::SystemManager<Num>&);
 template <typename Num>
+void sweepGrandCanonical(Thermodynamics::SystemManager<Num>&);
+template <typename Num>
+void sweepCanonical(Thermodynamics::SystemManager<Num>&);
+template <typename Num>
+void sweepEnsemble(Thermodynamics::SystemEnsemble<Num>&);
+template <typename Num>
+bool fitStates(Thermodynamics::LevelFitter<Num>&, Thermodynamics::SystemParameters<Num>&);
+template <typename Num>
+void editStates(Thermodynamics::SystemManager<Num>&);
+template <typename Num>
 void sweepElectricField(Thermodynamics::SystemManager<Num>&);
+template <typename Manager>
+void saveResults(Manager&, std::string&);
 
 //////////////////
 ///// main() /////
 //////////////////
 
 int main(void) {
+    unsigned short int n_systems;
+    cout << "How many systems should be calculated on the same temperature grid? ";
+    rangedGetterLoop(cin, cout, n_systems, static_cast<unsigned short>(1),
+                     std::numeric_limits<unsigned short int>::max(),
+                     "Please enter a positive integer: ");
+    if (n_systems > 1) {
+        Thermodynamics::SystemEnsemble<mpfr_float_1000> ensemble;
+        ensemble.acquire(n_systems);
+        sweepEnsemble(ensemble);
+        saveResults(ensemble, ensemble.filename);
+        return 0;
+    }
+
     Thermodynamics::SystemManager<mpfr_float_1000> system;
     system.params.acquire("config.cfg");
 
-    sweepTemperature(system);
-
-    cout << "\nSaving...\n";
+    std::string fit_response;
+    cout << "\nFit the state energies and chemical potentials to measured data? (y/n) ";
+    std::getline(cin, fit_response);
+    if (static_cast<char>(tolower(fit_response[0])) == 'y') {
+        Thermodynamics::LevelFitter<mpfr_float_1000> fitter;
+        if (!fitStates(fitter, system.params)) {
+            return 1;
+        }
+        saveResults(fitter, system.params.filename);
+        return 0;
+    }
 
-    bool success;
-    unsigned short tries = 3;
-    do {
-        success = system.save_to_disk(system.params.filename);
-        if (!success) {
-            cout << "The file could not be saved. Please enter a different file name: ";
-            cin  >> system.params.filename;
+    std::string gc_response, canonical_response;
+    cout << "\nSolve for the chemical potential that gives a fixed mean number of particles? (y/n) ";
+    std::getline(cin, gc_response);
+    if (static_cast<char>(tolower(gc_response[0])) == 'y') {
+        sweepGrandCanonical(system);
+        editStates(system);
+    }
+    else {
+        cout << "Calculate the canonical partition function of N identical particles? (y/n) ";
+        std::getline(cin, canonical_response);
+        if (static_cast<char>(tolower(canonical_response[0])) == 'y') {
+            sweepCanonical(system);
         }
-        tries--;
-    } while (!success && (tries > 0));
+        else {
+            sweepTemperature(system);
+            editStates(system);
+        }
+    }
+
+    saveResults(system, system.params.filename);
 
     return 0;
 }
@@ -61,12 +107,14 @@ int main(void) {
 ///////////////////////////
 
 /**
- *
+ * ask the user for the temperature grid
+ * @param T_min         (K) the first temperature
+ * @param T_step        (K) the spacing between temperatures
+ * @return              the number of temperature points
  */
 template <typename Num>
-void sweepTemperature(Thermodynamics::SystemManager<Num>& system) {
-    progressBar<unsigned int> pbar(80);
-    Num T_min, T_max, T_step, T_current;
+unsigned short int getTemperatureRange(Num& T_min, Num& T_step) {
+    Num T_max;
 
     cout << "What is the minimum temperature to calculate? ";
     getRangedInput(cin, T_min, static_cast<Num>(1e-100), static_cast<Num>(1e100));
@@ -75,7 +123,18 @@ void sweepTemperature(Thermodynamics::SystemManager<Num>& system) {
     cout << "What should the temperature step size be? ";
     getRangedInput(cin, T_step, static_cast<Num>(1e-100), static_cast<Num>(1e100));
 
-    const unsigned short int n_samp = static_cast<unsigned short int>(static_cast<Num>((T_max - T_min) / T_step));
+    return static_cast<unsigned short int>(static_cast<Num>((T_max - T_min) / T_step));
+}
+
+/**
+ * calculate the partition function over a range of temperatures at fixed chemical potentials
+ */
+template <typename Num>
+void sweepTemperature(Thermodynamics::SystemManager<Num>& system) {
+    progressBar<unsigned int> pbar(80);
+    Num T_min, T_step, T_current;
+
+    const unsigned short int n_samp = getTemperatureRange(T_min, T_step);
     system.initialize(n_samp);
 
     // just set total potential to zero for now
@@ -97,6 +156,228 @@ void sweepTemperature(Thermodynamics::SystemManager<Num>& system) {
     pbar.end();
 }
 
+/**
+ * calculate the partition function over a range of temperatures, solving at each
+ * one for the chemical potential that gives the target mean number of particles
+ */
+template <typename Num>
+void sweepGrandCanonical(Thermodynamics::SystemManager<Num>& system) {
+    progressBar<unsigned int> pbar(80);
+    Num T_min, T_step, T_current, N_target, mu;
+
+    if (system.params.states() < 2) {
+        cout << "Grand canonical mode needs at least two states; sweeping temperature only.\n";
+        sweepTemperature(system);
+        return;
+    }
+
+    // <N> can only lie strictly between the smallest and largest particle numbers
+    Num N_min, N_max;
+    unsigned short int tries = 3;
+    do {
+        system.params.acquire_occupancy();
+        N_min = N_max = system.params.occupancy(0);
+        for (unsigned short i = 1; i < system.params.states(); i++) {
+            if (system.params.occupancy(i) < N_min) N_min = system.params.occupancy(i);
+            if (system.params.occupancy(i) > N_max) N_max = system.params.occupancy(i);
+        }
+        if (N_min == N_max) {
+            cout << "At least two states must have different numbers of particles.\n";
+        }
+    } while (N_min == N_max && --tries > 0 && cin.good());
+    if (N_min == N_max) {
+        cout << "No usable particle numbers were entered; sweeping temperature only.\n";
+        sweepTemperature(system);
+        return;
+    }
+
+    cout << "What is the target mean number of particles (strictly between " << N_min << " and " << N_max << ")? ";
+    do {
+        rangedGetterLoop(cin, cout, N_target, N_min, N_max,
+                         "Please enter a number strictly between the smallest and largest particle numbers: ");
+        if (N_target == N_min || N_target == N_max) {
+            cout << "Please enter a number strictly between the smallest and largest particle numbers: ";
+        }
+    } while (N_target == N_min || N_target == N_max);
+    cout << "What is the initial guess for the chemical potential in eV? ";
+    getterLoop(cin, cout, mu, "Please enter a numerical value: ");
+
+    const unsigned short int n_samp = getTemperatureRange(T_min, T_step);
+    system.initialize(n_samp);
+
+    std::cout << "Please wait . . .\n";
+    pbar.initialize(cout, n_samp);
+
+    unsigned short int failures = 0;
+    T_current = T_min - T_step;
+    for (unsigned short i = 0; i < n_samp; i++) {
+        T_current += T_step;
+        system.params.set_T(T_current);
+        // warm start from the previous temperature's solution
+        if (!system.sample[i].solve_mu(system.params, N_target, mu, static_cast<Num>(1e-30))) {
+            failures++;
+        }
+        mu = system.params.potential();
+        pbar.increment(i);
+    }
+
+    pbar.end();
+
+    if (failures > 0) {
+        cout << "The chemical potential did not converge at " << failures << " temperature(s).\n";
+    }
+}
+
+/**
+ * calculate the canonical partition function of N identical bosons or fermions over a range of
+ * temperatures, splitting the temperatures between threads
+ */
+template <typename Num>
+void sweepCanonical(Thermodynamics::SystemManager<Num>& system) {
+    std::string stats_response;
+    unsigned short int N;
+    Num T_min, T_step;
+
+    cout << "How many particles? ";
+    rangedGetterLoop(cin, cout, N, static_cast<unsigned short>(1),
+                     std::numeric_limits<unsigned short int>::max(),
+                     "Please enter a positive integer: ");
+    cout << "Are the particles bosons or fermions? (b/f) ";
+    std::getline(cin, stats_response);
+    const Thermodynamics::Statistics stats = (static_cast<char>(tolower(stats_response[0])) == 'f' ?
+                                              Thermodynamics::fermions : Thermodynamics::bosons);
+
+    const unsigned short int n_samp = getTemperatureRange(T_min, T_step);
+    system.initialize(n_samp);
+
+    // just set total potential to zero for now
+    for (unsigned short i = 0; i < system.params.states(); i++) {
+        system.params.set_mu(i, 0.0);
+    }
+
+    std::cout << "Please wait . . .\n";
+    const Thermodynamics::SystemParameters<Num>& params = system.params;
+    parallelFor(n_samp, 0, [&](const unsigned int first, const unsigned int last) {
+        for (unsigned int i = first; i < last; i++) {
+            system.sample[i].calculate_canonical(params, static_cast<Num>(T_min + T_step * i), N, stats);
+        }
+    });
+}
+
+/**
+ * calculate several systems together over a range of temperatures at zero chemical potential
+ */
+template <typename Num>
+void sweepEnsemble(Thermodynamics::SystemEnsemble<Num>& ensemble) {
+    Num T_min, T_step;
+
+    const unsigned short int n_samp = getTemperatureRange(T_min, T_step);
+
+    // just set total potential to zero for now
+    for (unsigned short k = 0; k < ensemble.systems(); k++) {
+        for (unsigned short i = 0; i < ensemble.params[k].states(); i++) {
+            ensemble.params[k].set_mu(i, 0.0);
+        }
+    }
+    ensemble.initialize(n_samp);
+
+    std::cout << "Please wait . . .\n";
+    ensemble.calculate(T_min, T_step, 0);
+}
+
+/**
+ * fit the state energies and total chemical potentials to a dataset of heat capacities and populations
+ */
+template <typename Num>
+bool fitStates(Thermodynamics::LevelFitter<Num>& fitter, Thermodynamics::SystemParameters<Num>& params) {
+    std::string data_name;
+    unsigned int max_iterations;
+    bool success;
+    unsigned short tries;
+
+    // a limited number of tries, so a closed input stream cannot loop forever
+    cout << "Enter the name of the data file: ";
+    std::getline(cin, data_name);
+    success = fitter.load(data_name, params);
+    tries = 3;
+    while (!success && --tries > 0 && cin.good()) {
+        cout << "The data file could not be read. Please enter a different file name: ";
+        std::getline(cin, data_name);
+        success = fitter.load(data_name, params);
+    }
+    if (!success) {
+        cout << "No data could be loaded.\n";
+        return false;
+    }
+
+    cout << "What is the largest number of iterations? ";
+    success = getRangedInput(cin, max_iterations, 1u, std::numeric_limits<unsigned int>::max());
+    tries = 3;
+    while (!success && --tries > 0 && cin.good()) {
+        cout << "Please enter a positive integer: ";
+        success = getRangedInput(cin, max_iterations, 1u, std::numeric_limits<unsigned int>::max());
+    }
+    if (!success) {
+        cout << "No iteration limit was given.\n";
+        return false;
+    }
+
+    cout << "Fitting " << fitter.points() << " data points . . .\n";
+    fitter.solve(max_iterations, cout);
+
+    return true;
+}
+
+/**
+ * let the user change state energies after a sweep, updating only the changed states
+ */
+template <typename Num>
+void editStates(Thermodynamics::SystemManager<Num>& system) {
+    std::string edit_response;
+    unsigned short int state;
+    Num energy;
+
+    // there is nothing to edit, and no valid state number to ask for
+    if (system.params.states() == 0) {
+        return;
+    }
+
+    cout << "\nChange the energy of a state and recalculate? (y/n) ";
+    std::getline(cin, edit_response);
+    while (static_cast<char>(tolower(edit_response[0])) == 'y') {
+        cout << "Which state (1 to " << system.params.states() << ")? ";
+        rangedGetterLoop(cin, cout, state, static_cast<unsigned short>(1), system.params.states(),
+                         "Please enter a valid state number: ");
+        cout << "Enter the new energy of state " << state << " in eV: ";
+        getterLoop(cin, cout, energy, "Please enter a numerical value: ");
+        system.update_state(state - 1, energy);
+
+        cout << "Change another state? (y/n) ";
+        std::getline(cin, edit_response);
+    }
+}
+
+/**
+ * save the results, asking for a new file name if saving fails
+ * @param manager       the object holding the results
+ * @param filename      the name of the save file; replaced if the user enters a new one
+ */
+template <typename Manager>
+void saveResults(Manager& manager, std::string& filename) {
+    cout << "\nSaving...\n";
+
+    bool success;
+    unsigned short tries = 3;
+    do {
+        success = manager.save_to_disk(filename);
+        if (!success) {
+            cout << "The file could not be saved. Please enter a different file name: ";
+            cin  >> filename;
+        }
+        tries--;
+    } while (!success && (tries > 0));
+}
+
 /**
  *
  */
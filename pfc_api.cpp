@@ -0,0 +1,21 @@
+/*
+ * C interface to the batch evaluation routines
+ */
+
+#include "pfc_api.h"
+#include "batch.hpp"
+
+//! (eV/K) Boltzmann constant, matching Constants::k_B
+static const double pfc_k_B = 8.6173324e-5;
+
+int pfc_evaluate_batch(const double* E, const double* mu, const double* occupancy, unsigned short n,
+                       const double* T, unsigned int n_T, double* lnZ, double* P, double* N, double* dN_dmu) {
+    if (E == nullptr || mu == nullptr || T == nullptr || lnZ == nullptr || P == nullptr) {
+        return 1;
+    }
+    if (!Thermodynamics::evaluateBatch(E, mu, occupancy, n, T, n_T, pfc_k_B, lnZ, P, N, dN_dmu)) {
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * C interface to the batch evaluation routines, in double precision
+ *
+ * pfc_api.cpp only needs the C++ standard library; it does not use Boost or MPFR.
+ */
+
+#ifndef PFC_API_H
+    #define PFC_API_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * calculate the logarithm of the partition function and the state probabilities over a set of temperatures;
+ * the exponents are shifted by the lowest E - mu, so ln Z and the probabilities stay finite where Z itself
+ * would overflow or underflow a double. Every buffer belongs to the caller, and the function is safe to call
+ * from several threads at once
+ * @param E             (eV) array of n state energies
+ * @param mu            (eV) array of n total chemical potentials
+ * @param occupancy     array of n particle numbers, or NULL
+ * @param n             the number of states
+ * @param T             (K) array of n_T temperatures
+ * @param n_T           the number of temperatures
+ * @param lnZ           output array of n_T logarithms of the partition function
+ * @param P             output array of n_T * n state probabilities, one row of n per temperature
+ * @param N             output array of n_T mean particle numbers, or NULL
+ * @param dN_dmu        (per eV) output array of n_T derivatives of <N> with respect to mu, or NULL
+ * @return              0 on success, 1 if a required pointer is NULL, 2 if a result is not finite
+ */
+int pfc_evaluate_batch(const double* E, const double* mu, const double* occupancy, unsigned short n,
+                       const double* T, unsigned int n_T, double* lnZ, double* P, double* N, double* dN_dmu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif